@@ -14,16 +14,44 @@
 /***************** Main Function ******************/
 
 
+/***************** Global Variables ******************/
+
+uint32_t sector_size = SECTOR_SIZE;
+
+
 int main(int argc , char **argv){
 
+    int opt;
+    char *end;
+    uint32_t sector_size_override = 0;
+
+    /**< Parse the options (-b lets the user force the sector size for disk images) */
+    while((opt = getopt(argc , argv , "b:")) != -1){
+        switch(opt){
+            case 'b':
+                sector_size_override = (uint32_t)strtoul(optarg , &end , 10);
+                if(*end != '\0' || !is_valid_sector_size(sector_size_override)){
+                    printf("Error: Invalid sector size %s (expected 512, 1024, 2048 or 4096)\n" , optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printf("Usage: %s [-b sector_size] <device>\n" , argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
     /**< Check if the number of arguments is correct */
-    if(argc != 2){
-        printf("Usage: %s <device>\n" , argv[0]);
+    if(argc - optind != 1){
+        printf("Usage: %s [-b sector_size] <device>\n" , argv[0]);
         return EXIT_FAILURE;
     }
 
     /**< Get the device name */
-    char *device = argv[1];
+    char *device = argv[optind];
+
+    /**< Use the override if given, otherwise ask the device for its logical sector size */
+    sector_size = sector_size_override != 0 ? sector_size_override : get_sector_size(device);
 
     /**< Read the partition table */
     read_partition_table(device);
@@ -32,9 +60,36 @@ int main(int argc , char **argv){
 }
 
 
+int is_valid_sector_size(uint32_t size){
+    /**< Must be a power of two between 512 and 4096 bytes */
+    return size >= SECTOR_SIZE && size <= MAX_SECTOR_SIZE && (size & (size - 1)) == 0;
+}
+
+
+uint32_t get_sector_size(char *device){
+
+    int fd = open(device , O_RDONLY);
+
+    if(fd == -1){
+        printf("Error: Failed to open the device\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /**< BLKSSZGET only works on block devices, regular image files fall back to the default */
+    int logical_size = 0;
+    if(ioctl(fd , BLKSSZGET , &logical_size) == -1 || !is_valid_sector_size((uint32_t)logical_size)){
+        logical_size = SECTOR_SIZE;
+    }
+
+    close(fd);
+
+    return (uint32_t)logical_size;
+}
+
+
 void read_partition_table(char *device){
 
-    char buffer[SECTOR_SIZE];
+    char buffer[MAX_SECTOR_SIZE];
 
     int fd = open(device , O_RDONLY); // Open the device in read only mode
 
@@ -46,7 +101,8 @@ void read_partition_table(char *device){
 
     
 
-    if(read(fd , buffer , SECTOR_SIZE) != SECTOR_SIZE){
+    /**< Read a whole logical sector so block devices never see a partial-sector read */
+    if(read(fd , buffer , sector_size) != sector_size){
         printf("Error: Failed to read the partition table\n");
         close(fd);
         exit(EXIT_FAILURE);
@@ -98,7 +154,7 @@ void process_partition_table(char *device, uint8_t partition_number, PartitionEn
            table_entry_ptr->lba,                                         /**< Start sector */ 
            table_entry_ptr->lba + table_entry_ptr->sector_count - 1,     /**< End sector */ 
            table_entry_ptr->sector_count,                             /**< Number of sectors */ 
-           (double)table_entry_ptr->sector_count * SECTOR_SIZE / (1024 * 1024 * 1024), /**< Size in GB */
+           (double)table_entry_ptr->sector_count * sector_size / (1024 * 1024 * 1024), /**< Size in GB */
            table_entry_ptr->type,                                        /**< Partition ID */
            get_partition_type_name(table_entry_ptr->type));              /**< Partition type name */
 }
@@ -128,7 +184,7 @@ void read_mbr_partition_table(char *device , PartitionEntry *table_entry_ptr){
 
 void read_ebr_partition_table(char *device , uint32_t current_ebr_lba , uint32_t extended_partition_start , int logical_num){
 
-    char buffer[SECTOR_SIZE];
+    char buffer[MAX_SECTOR_SIZE];
 
     // Open the device in read only mode
     uint32_t fd = open(device , O_RDONLY);
@@ -140,7 +196,7 @@ void read_ebr_partition_table(char *device , uint32_t current_ebr_lba , uint32_t
     }
     
     /**< Calculate the offset of the EBR sector */
-    off_t offset = current_ebr_lba * SECTOR_SIZE;
+    off_t offset = (off_t)current_ebr_lba * sector_size;
 
     /**< Seek to the EBR sector */
     off_t curr_offset = lseek(fd , offset , SEEK_SET);
@@ -151,7 +207,7 @@ void read_ebr_partition_table(char *device , uint32_t current_ebr_lba , uint32_t
         exit(EXIT_FAILURE);
     }
 
-    if(read(fd , buffer , SECTOR_SIZE) != SECTOR_SIZE){
+    if(read(fd , buffer , sector_size) != sector_size){
         printf("Error: Failed to read the EBR sector\n");
         close(fd);
         exit(EXIT_FAILURE);
@@ -186,7 +242,7 @@ void process_gpt_partition(char *device, uint8_t partition_number, GptPartitionE
            (unsigned long long)gpt_entry->starting_lba,                  /**< Start sector */ 
            (unsigned long long)gpt_entry->ending_lba,                   /**< End sector */ 
            (unsigned long long)(gpt_entry->ending_lba - gpt_entry->starting_lba + 1), /**< Number of sectors */ 
-           (double)(gpt_entry->ending_lba - gpt_entry->starting_lba + 1) * SECTOR_SIZE / (1024 * 1024 * 1024), /**< Size in GB */
+           (double)(gpt_entry->ending_lba - gpt_entry->starting_lba + 1) * sector_size / (1024 * 1024 * 1024), /**< Size in GB */
            "M",                                                        /**< Partition ID */
            "GPT Partition");                                             /**< Partition type name */
 }
@@ -194,7 +250,7 @@ void process_gpt_partition(char *device, uint8_t partition_number, GptPartitionE
 
 
 void read_gpt_partition_table(char *device){
-    char buffer[SECTOR_SIZE];
+    char buffer[MAX_SECTOR_SIZE];
 
     int fd = open(device , O_RDONLY);
 
@@ -203,10 +259,16 @@ void read_gpt_partition_table(char *device){
         exit(EXIT_FAILURE);
     }
 
-    // lseek to sector number 1
-    off_t cur_offset = lseek(fd , 1 * SECTOR_SIZE , SEEK_SET);
+    // lseek to sector number 1 (the GPT header always lives in LBA 1 whatever the sector size is)
+    off_t cur_offset = lseek(fd , (off_t)1 * sector_size , SEEK_SET);
 
-    if(read(fd , buffer , SECTOR_SIZE) != SECTOR_SIZE){
+    if(cur_offset != (off_t)sector_size){
+        printf("Error: Failed to seek to the GPT header\n");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+
+    if(read(fd , buffer , sector_size) != sector_size){
         printf("Error: Failed to read the GPT header\n");
         close(fd);
         exit(EXIT_FAILURE);
@@ -225,12 +287,22 @@ void read_gpt_partition_table(char *device){
         exit(EXIT_FAILURE);
     }
 
+    // The entry size is 128 * 2^n bytes, anything else means a corrupted header
+    uint32_t entry_size = gpt_header->partition_entry_size;
+    uint32_t num_entries = gpt_header->num_partition_entries;
+
+    if(entry_size < GPT_MIN_ENTRY_SIZE || (entry_size & (entry_size - 1)) != 0){
+        printf("Error: Invalid GPT partition entry size %u\n", entry_size);
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+
     /**< Print the header for the GPT partition table information with bold text */ 
     printf("\033[1m%-12s %5s  %8s %-10s %-10s %-10s %-5s %-15s\033[0m\n", "Device",
            "Boot", "Start", "End", "Sectors", "Size", "Id", "Type");
 
     // Calculate partition entries location and read them
-    cur_offset = gpt_header->partition_entries_lba * SECTOR_SIZE;
+    cur_offset = (off_t)gpt_header->partition_entries_lba * sector_size;
     
     if(lseek(fd, cur_offset, SEEK_SET) != cur_offset){
         printf("Error: Failed to seek to partition entries\n");
@@ -238,26 +310,36 @@ void read_gpt_partition_table(char *device){
         exit(EXIT_FAILURE);
     }
 
-    // Read partition entries (allocate buffer for entries)
-    uint8_t partition_buffer[512 * 128]; // Buffer for partition entries
-    uint32_t entries_size = gpt_header->num_partition_entries * gpt_header->partition_entry_size;
-    
-    if(read(fd, partition_buffer, entries_size) != entries_size){
+    // Size the entry array from the header and round it up to whole sectors
+    size_t entries_size = (size_t)num_entries * entry_size;
+    size_t read_size = ((entries_size + sector_size - 1) / sector_size) * sector_size;
+
+    uint8_t *partition_buffer = malloc(read_size);
+
+    if(partition_buffer == NULL){
+        printf("Error: Failed to allocate memory for partition entries\n");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+
+    if(read(fd, partition_buffer, read_size) != (ssize_t)read_size){
         printf("Error: Failed to read partition entries\n");
+        free(partition_buffer);
         close(fd);
         exit(EXIT_FAILURE);
     }
 
-    // Process each partition entry
-    GptPartitionEntry *gpt_entries = (GptPartitionEntry *)partition_buffer;
-    
-    for(uint32_t i = 0; i < gpt_header->num_partition_entries; i++){
+    // Process each partition entry, walking the array by the entry size from the header
+    for(uint32_t i = 0; i < num_entries; i++){
+        GptPartitionEntry *gpt_entry = (GptPartitionEntry *)(partition_buffer + (size_t)i * entry_size);
+
         // Check if partition is valid (has a starting LBA)
-        if(gpt_entries[i].starting_lba != 0){
-            process_gpt_partition(device, i, &gpt_entries[i]);
+        if(gpt_entry->starting_lba != 0){
+            process_gpt_partition(device, i, gpt_entry);
         }
     }
 
+    free(partition_buffer);
     close(fd);
 
 }
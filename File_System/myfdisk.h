@@ -17,10 +17,18 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 
 /***************** Definitions ******************/
 
-#define SECTOR_SIZE 512
+#define SECTOR_SIZE 512              /**< Default logical sector size (used for images / when detection fails) */
+#define MAX_SECTOR_SIZE 4096         /**< Largest logical sector size we accept */
+#define GPT_MIN_ENTRY_SIZE 128       /**< Minimum size of a GPT partition entry per the UEFI spec */
+
+/***************** Global Variables ******************/
+
+extern uint32_t sector_size;         /**< Logical sector size in bytes used for all offset math */
 
 /***************** Structures ******************/
 
@@ -62,6 +70,20 @@ typedef struct {
 
 /***************** Functions Prototypes ******************/
 
+/**
+ * @brief Query the logical sector size of the device
+ * @param device The name of the device
+ * @return The logical sector size in bytes (SECTOR_SIZE if it can't be queried, e.g. for image files)
+ */
+uint32_t get_sector_size(char *device);
+
+/**
+ * @brief Check that a sector size is a power of two within [SECTOR_SIZE, MAX_SECTOR_SIZE]
+ * @param size The sector size in bytes
+ * @return 1 if valid, 0 otherwise
+ */
+int is_valid_sector_size(uint32_t size);
+
 /**
  * @brief Read the partition table from the device
  * @param device The device to read the partition table from
@@ -2,12 +2,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 // Global variable definitions
 uint8_t heap[HEAP_MAX_SIZE];
 size_t program_break;
 BlockHeader *free_list_head;
+HandleEntry handle_table[HMM_MAX_HANDLES];
+BlockHeader *compact_cursor;    // Where the next HmmCompactStep resumes the walk
 
 int ceiling(int a , int b)
 {
@@ -32,6 +35,11 @@ void Coalescing_blocks(BlockHeader *head){
             
             // Store the next free block to remove
             BlockHeader *next_free = cur->next_free;
+
+            // Don't leave the compactor cursor inside the merged block
+            if(compact_cursor == next_free){
+                compact_cursor = cur;
+            }
             
             // Update pointers
             if(next_free->next_free != NULL){
@@ -57,26 +65,26 @@ void Heap_Shrinking(void){
     // Get the address of the end of the heap
     uint8_t *heap_end = heap + program_break; 
 
-    // Check if free list is not empty
-    if (free_list_head != NULL) {
-        // Check the first free block (could be coalesced with freed block)
-        uint8_t *block_end = (uint8_t *)free_list_head + HEADER_SIZE + free_list_head->size;
+    // Find the free block that ends at the top of the heap (it's not always the head of the free list)
+    BlockHeader *top_block = free_list_head;
+    while (top_block != NULL && NEXT_BLOCK(top_block) != (BlockHeader *)heap_end) {
+        top_block = top_block->next_free;
+    }
 
-        // Check if this block at the end of heap
-        if (block_end == heap_end) {
-            size_t shrink_amount = HEADER_SIZE + free_list_head->size;
-            
-            // Only shrink if size meets threshold and won't go below minimum
-            if (shrink_amount >= shrink_thershold && (program_break - shrink_amount) >= min_heap_size) {
-                // Remove top block from free list
-                BlockHeader *next_free = free_list_head->next_free;
-                if (next_free != NULL) {
-                    next_free->prev_free = NULL;
-                }
-                free_list_head = next_free;
+    if (top_block != NULL) {
+        size_t shrink_amount = HEADER_SIZE + top_block->size;
+
+        // Only shrink if size meets threshold and won't go below minimum
+        if (shrink_amount >= shrink_thershold && (program_break - shrink_amount) >= min_heap_size) {
+            // Remove top block from free list
+            Remove_free_block(top_block);
+
+            // Shrink the program break
+            program_break -= shrink_amount;
 
-                // Shrink the program break
-                program_break -= shrink_amount;
+            // The compactor cursor may now point past the end of the heap
+            if ((uint8_t *)compact_cursor >= heap + program_break) {
+                compact_cursor = (BlockHeader *)heap;
             }
         }
     }
@@ -101,12 +109,17 @@ void HmmInit(void) {
     // Add the Block_header to the start of the heap 
     BlockHeader *initial_header = (BlockHeader *)heap;
     initial_header->is_allocated = false;
+    initial_header->handle = 0;
     initial_header->size = total_needed_init_space - HEADER_SIZE;
     initial_header->prev_free = NULL;
     initial_header->next_free = NULL;
 
     free_list_head = initial_header;
 
+    // No handles are in use yet
+    memset(handle_table, 0, sizeof(handle_table));
+    compact_cursor = (BlockHeader *)heap;
+
 
     // Print initialization details
     printf("HMM Initialized (OS-like behavior with 8-byte alignment):\n");
@@ -144,6 +157,7 @@ void *HmmAlloc(uint32_t needed_size) {
                 // setup the free block meta data
                 new_free_block->size = cur->size - aligned_size - HEADER_SIZE; 
                 new_free_block->is_allocated = false;
+                new_free_block->handle = 0;
                 new_free_block->prev_free = cur->prev_free;
                 new_free_block->next_free = cur->next_free;
 
@@ -185,6 +199,7 @@ void *HmmAlloc(uint32_t needed_size) {
             // setup the allocated block metadata
 
             ptr_allocated->is_allocated = true;
+            ptr_allocated->handle = 0;
             ptr_allocated->next_free = NULL;
             ptr_allocated->prev_free = NULL;
 
@@ -212,6 +227,7 @@ void *HmmAlloc(uint32_t needed_size) {
 
         // Setup metadata
         new_block->is_allocated = true;
+        new_block->handle = 0;
         new_block->size = aligned_size;
         new_block->next_free = NULL;
         new_block->prev_free = NULL;
@@ -223,7 +239,7 @@ void *HmmAlloc(uint32_t needed_size) {
         
     }
 
-    return ((void *)(ptr_allocated + HEADER_SIZE));
+    return ((void *)((uint8_t *)ptr_allocated + HEADER_SIZE));
 
 }
 
@@ -242,6 +258,11 @@ void HmmFree(void *ptr) {
         return; // Already free
     }
 
+    // Handle blocks must be released with HmmHandleFree to keep the handle table valid
+    if (block_to_free->handle != 0) {
+        return;
+    }
+
     // Mark as free
     block_to_free->is_allocated = false;
 
@@ -263,11 +284,285 @@ void HmmFree(void *ptr) {
 
 }
 
+void Remove_free_block(BlockHeader *block){
+    // Unlink the block from the free list
+    if(block->prev_free != NULL){
+        block->prev_free->next_free = block->next_free;
+    }
+
+    if(block->next_free != NULL){
+        block->next_free->prev_free = block->prev_free;
+    }
+
+    if(free_list_head == block){
+        free_list_head = block->next_free;
+    }
+
+    block->next_free = NULL;
+    block->prev_free = NULL;
+}
+
+void Insert_free_block(BlockHeader *block){
+    // Insert at beginning of free list
+    block->next_free = free_list_head;
+    block->prev_free = NULL;
+
+    if (free_list_head != NULL) {
+        free_list_head->prev_free = block;
+    }
+
+    free_list_head = block;
+}
+
+/**
+ * Move an unlocked handle block down into the free block right before it
+ * The free space ends up after the moved block (merged with the next block if it's free)
+ * Returns the new free block
+ */
+BlockHeader *Slide_block_down(BlockHeader *free_block, BlockHeader *block){
+    uint32_t free_size = free_block->size;
+    size_t block_total = HEADER_SIZE + block->size;
+
+    Remove_free_block(free_block);
+
+    // Regions overlap so we have to use memmove
+    memmove(free_block, block, block_total);
+
+    // Point the handle to the new location of the block
+    BlockHeader *moved_block = free_block;
+    handle_table[moved_block->handle - 1].block = moved_block;
+
+    // Setup the free block after the moved one
+    BlockHeader *new_free_block = NEXT_BLOCK(moved_block);
+    new_free_block->is_allocated = false;
+    new_free_block->handle = 0;
+    new_free_block->size = free_size;
+
+    // Merge with the next block if it's also free
+    BlockHeader *next_block = NEXT_BLOCK(new_free_block);
+    if((uint8_t *)next_block < heap + program_break && !next_block->is_allocated){
+        Remove_free_block(next_block);
+        new_free_block->size += HEADER_SIZE + next_block->size;
+    }
+
+    Insert_free_block(new_free_block);
+
+    return new_free_block;
+}
+
+/**
+ * Incremental compaction: walk the heap and slide unlocked handle blocks down
+ * into the free space before them, at most max_moves times
+ * The walk resumes from where the previous step stopped and wraps around to the
+ * bottom of the heap at most once, so a step never scans more than one full lap
+ * Free space bubbles up to the top of the heap where Heap_Shrinking can release it
+ * Returns the number of blocks moved
+ */
+uint32_t HmmCompactStep(uint32_t max_moves){
+    uint32_t moves = 0;
+    bool wrapped = false;
+
+    if((uint8_t *)compact_cursor < heap || (uint8_t *)compact_cursor >= heap + program_break){
+        compact_cursor = (BlockHeader *)heap;
+    }
+
+    uint8_t *start = (uint8_t *)compact_cursor;
+    BlockHeader *cur = compact_cursor;
+
+    while(moves < max_moves){
+        // Reached the top, continue from the bottom until we get back to the start
+        if((uint8_t *)cur >= heap + program_break){
+            if(wrapped || start == heap){
+                cur = (BlockHeader *)heap;
+                break;
+            }
+            cur = (BlockHeader *)heap;
+            wrapped = true;
+        }
+
+        if(wrapped && (uint8_t *)cur >= start){
+            break;
+        }
+
+        BlockHeader *next = NEXT_BLOCK(cur);
+
+        // Nothing to fill if the block is allocated or it's the last block
+        if(cur->is_allocated || (uint8_t *)next >= heap + program_break){
+            cur = next;
+            continue;
+        }
+
+        if(!next->is_allocated){
+            // Two adjacent free blocks that weren't coalesced, merge them
+            Remove_free_block(next);
+            cur->size += HEADER_SIZE + next->size;
+        }
+        else if(next->handle != 0 && handle_table[next->handle - 1].lock_count == 0){
+            // Movable block, slide it down and continue from the free space after it
+            cur = Slide_block_down(cur, next);
+            moves++;
+        }
+        else {
+            // Fixed or locked block, skip it
+            cur = next;
+        }
+    }
+
+    // Resume from here next time
+    compact_cursor = (uint8_t *)cur < heap + program_break ? cur : (BlockHeader *)heap;
+
+    // Release the free space if it reached the top of the heap
+    Heap_Shrinking();
+
+    return moves;
+}
+
+HmmHandle HmmHandleAlloc(uint32_t needed_size){
+    // Find an unused slot in the handle table
+    uint32_t slot;
+    for(slot = 0; slot < HMM_MAX_HANDLES; slot++){
+        if(handle_table[slot].block == NULL){
+            break;
+        }
+    }
+
+    if(slot == HMM_MAX_HANDLES){
+        return HMM_INVALID_HANDLE;
+    }
+
+    void *ptr = HmmAlloc(needed_size);
+
+    // Out of space, compact the whole heap and try again
+    if(ptr == NULL && needed_size != 0){
+        HmmCompactStep(UINT32_MAX);
+        ptr = HmmAlloc(needed_size);
+    }
+
+    if(ptr == NULL){
+        return HMM_INVALID_HANDLE;
+    }
+
+    BlockHeader *block = (BlockHeader *)((uint8_t *)ptr - HEADER_SIZE);
+    block->handle = slot + 1; // handles start from 1, 0 is invalid
+
+    handle_table[slot].block = block;
+    handle_table[slot].lock_count = 0;
+
+    return block->handle;
+}
+
+void HmmHandleFree(HmmHandle handle){
+    // Validate input
+    if(handle == HMM_INVALID_HANDLE || handle > HMM_MAX_HANDLES || handle_table[handle - 1].block == NULL){
+        return;
+    }
+
+    BlockHeader *block = handle_table[handle - 1].block;
+
+    // Release the handle slot
+    handle_table[handle - 1].block = NULL;
+    handle_table[handle - 1].lock_count = 0;
+
+    // Free it like a normal block
+    block->handle = 0;
+    HmmFree((uint8_t *)block + HEADER_SIZE);
+
+    // Amortized compaction
+    HmmCompactStep(HMM_COMPACT_STEP_MOVES);
+}
+
+void *HmmLock(HmmHandle handle){
+    // Validate input
+    if(handle == HMM_INVALID_HANDLE || handle > HMM_MAX_HANDLES || handle_table[handle - 1].block == NULL){
+        return NULL;
+    }
+
+    // Pin the block so the compactor won't move it while the pointer is in use
+    handle_table[handle - 1].lock_count++;
+
+    return (void *)((uint8_t *)handle_table[handle - 1].block + HEADER_SIZE);
+}
+
+void HmmUnlock(HmmHandle handle){
+    // Validate input
+    if(handle == HMM_INVALID_HANDLE || handle > HMM_MAX_HANDLES || handle_table[handle - 1].block == NULL){
+        return;
+    }
+
+    if(handle_table[handle - 1].lock_count == 0){
+        return; // Not locked
+    }
+
+    handle_table[handle - 1].lock_count--;
+
+    // Amortized compaction once the block is movable again
+    if(handle_table[handle - 1].lock_count == 0){
+        HmmCompactStep(HMM_COMPACT_STEP_MOVES);
+    }
+}
+
 int main(int argc, char **argv) {
     // Initialize the heap memory manager
     HmmInit();
     
     printf("\nHeap Memory Manager initialized successfully!\n");
-    
+
+    // Demo: fragment the heap with handle blocks, then compact it back
+    HmmHandle handles[10];
+    uint32_t block_size = 200;
+
+    // A fixed block at the bottom of the heap, the compactor must not move it
+    uint8_t *fixed = HmmAlloc(64);
+    memset(fixed, 0xAB, 64);
+
+    for (int i = 0; i < 10; i++) {
+        handles[i] = HmmHandleAlloc(block_size);
+
+        // Fill each block with its index so we can check it after the moves
+        uint8_t *data = HmmLock(handles[i]);
+        memset(data, i, block_size);
+        HmmUnlock(handles[i]);
+    }
+
+    // HmmFree must refuse a pointer that belongs to a handle
+    uint8_t *locked = HmmLock(handles[1]);
+    HmmFree(locked);
+    HmmUnlock(handles[1]);
+
+    printf("\nProgram break before freeing   : %zu\n", program_break);
+
+    // Free every other handle block to leave holes below the program break
+    // (each free also runs one amortized compaction step)
+    for (int i = 0; i < 10; i += 2) {
+        HmmHandleFree(handles[i]);
+    }
+
+    // Finish the compaction
+    while (HmmCompactStep(1) != 0) {
+    }
+
+    printf("Program break after compaction : %zu (live data: %zu)\n", program_break,
+           (size_t)(HEADER_SIZE + 64) + 5 * (HEADER_SIZE + block_size));
+
+    // Check that the data survived the moves
+    bool data_ok = true;
+    for (int i = 1; i < 10; i += 2) {
+        uint8_t *data = HmmLock(handles[i]);
+        for (uint32_t j = 0; j < block_size; j++) {
+            if (data[j] != i) {
+                data_ok = false;
+            }
+        }
+        HmmUnlock(handles[i]);
+    }
+
+    for (int i = 0; i < 64; i++) {
+        if (fixed[i] != 0xAB) {
+            data_ok = false;
+        }
+    }
+
+    printf("Payload data after compaction  : %s\n", data_ok ? "OK" : "CORRUPTED");
+
     return 0;
 }
\ No newline at end of file
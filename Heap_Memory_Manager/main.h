@@ -13,15 +13,33 @@
 #define MIN_BLOCK_SIZE 8
 #define HEADER_SIZE sizeof(BlockHeader)
 
+// Handle-based (relocatable) allocation constants
+#define HMM_MAX_HANDLES 256             // Size of the handle table
+#define HMM_INVALID_HANDLE 0            // Returned when a handle allocation fails
+#define HMM_COMPACT_STEP_MOVES 1        // Blocks moved by the amortized compactor per free/unlock
+
+// Get the block that physically follows a block in the heap
+#define NEXT_BLOCK(block) ((BlockHeader *)((uint8_t *)(block) + HEADER_SIZE + (block)->size))
+
 
 // Block header structure for memory management
 typedef struct BlockHeader {
     bool is_allocated;              // Allocation status flag 1 bytes
+    uint16_t handle;                // Owning handle (0 for fixed blocks) 2 bytes (fits in the padding)
     uint32_t size;                    // Size of usable memory (excluding header) 4 bytes
     struct BlockHeader *prev_free;  // Pointer to previous free block in free list 8 bytes 
     struct BlockHeader *next_free;  // Pointer to next free block in free list 8 bytes 
 } BlockHeader;
 
+// Handle to a relocatable block, 0 is never a valid handle
+typedef uint16_t HmmHandle;
+
+// Handle table entry, maps a handle to the current location of its block
+typedef struct {
+    BlockHeader *block;             // Current block header (NULL if the slot is unused)
+    uint32_t lock_count;            // Block can only be moved by the compactor while this is 0
+} HandleEntry;
+
 
 
 
@@ -34,4 +52,16 @@ void Coalescing_blocks(BlockHeader *head);
 void Heap_Shrinking(void);
 int ceiling(int a , int b);
 
+// Handle-based allocation (blocks can be moved by the compactor while unlocked)
+HmmHandle HmmHandleAlloc(uint32_t needed_size);
+void HmmHandleFree(HmmHandle handle);
+void *HmmLock(HmmHandle handle);
+void HmmUnlock(HmmHandle handle);
+
+// Incremental compaction
+uint32_t HmmCompactStep(uint32_t max_moves);
+BlockHeader *Slide_block_down(BlockHeader *free_block, BlockHeader *block);
+void Remove_free_block(BlockHeader *block);
+void Insert_free_block(BlockHeader *block);
+
 #endif // MAIN_H